@@ -0,0 +1,64 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "util_fgd.hpp"
+#include "util_fgd_schema.hpp"
+#include <fsys/filesystem.h>
+#include <iostream>
+#include <fstream>
+#include <exception>
+
+// Usage: util_fgd_compiler <input.fgd> <output.cpp> [symbolName]
+// Includes referenced by the input file are resolved relative to the directory of the input file.
+int main(int argc,char *argv[])
+{
+	if(argc < 3)
+	{
+		std::cerr<<"Usage: "<<argv[0]<<" <input.fgd> <output.cpp> [symbolName]"<<std::endl;
+		return EXIT_FAILURE;
+	}
+	std::string inputFile = argv[1];
+	std::string outputFile = argv[2];
+	std::string symbolName = (argc > 3) ? argv[3] : "g_fgdSchema";
+
+	std::string inputDir {};
+	auto posSep = inputFile.find_last_of("/\\");
+	if(posSep != std::string::npos)
+		inputDir = inputFile.substr(0,posSep +1);
+	// The parser throws on malformed input
+	std::string source {};
+	try
+	{
+		auto data = util::fgd::load_fgd(inputFile,[&inputFile,&inputDir](const std::string &fileName) -> std::shared_ptr<VFilePtrInternal> {
+			if(fileName == inputFile)
+				return FileManager::OpenSystemFile(fileName.c_str(),"r");
+			return FileManager::OpenSystemFile((inputDir +fileName).c_str(),"r");
+		});
+		if(data.has_value() == false)
+		{
+			std::cerr<<"Unable to load FGD file '"<<inputFile<<"'!"<<std::endl;
+			return EXIT_FAILURE;
+		}
+		source = util::fgd::schema::generate_source(*data,symbolName,inputFile);
+	}
+	catch(const std::exception &e)
+	{
+		std::cerr<<"Unable to compile FGD file '"<<inputFile<<"': "<<e.what()<<std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::ofstream f {outputFile,std::ios::out | std::ios::binary | std::ios::trunc};
+	if(f.is_open() == false)
+	{
+		std::cerr<<"Unable to open output file '"<<outputFile<<"'!"<<std::endl;
+		return EXIT_FAILURE;
+	}
+	f<<source;
+	if(f.good() == false)
+	{
+		std::cerr<<"Unable to write output file '"<<outputFile<<"'!"<<std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -12,6 +12,8 @@
 #include <optional>
 #include <functional>
 #include <limits>
+#include <list>
+#include <mutex>
 class VFilePtrInternal;
 
 namespace util
@@ -34,6 +36,12 @@ namespace util
 		struct DataObject;
 		using PDataObject = std::shared_ptr<DataObject>;
 
+		namespace schema
+		{
+			struct KeyValue;
+			struct Class;
+		};
+
 		class KeyValue
 		{
 		public:
@@ -75,13 +83,18 @@ namespace util
 				bool defaultOn;
 			};
 			KeyValue(const DataObject &obj);
+			KeyValue(const schema::KeyValue &kv);
 			const std::string &GetName() const;
 			const std::string &GetShortDescription() const;
 			const std::string &GetLongDescription() const;
 			const std::string &GetDefault() const;
 			Type GetType() const;
 			const std::unordered_map<std::string,Choice> &GetChoices() const;
+			// Structural hash of the keyvalue's name, descriptions, default value, type and choices
+			uint64_t GetHash() const;
 		private:
+			void UpdateHash();
+
 			std::string m_name = {};
 			std::string m_shortDesc = {};
 			std::string m_longDesc = {};
@@ -90,6 +103,7 @@ namespace util
 
 			// Only used if type is Type::Choices or Type::Flags
 			std::unordered_map<std::string,Choice> m_choices = {};
+			uint64_t m_hash = 0;
 		};
 
 		struct Data;
@@ -101,6 +115,8 @@ namespace util
 		{
 		public:
 			ClassDefinition(const Data &fgdData,const DataObject &obj);
+			// Base classes are looked up by index in 'classes', which contains all previously loaded classes of the schema
+			ClassDefinition(const std::vector<PClassDefinition> &classes,const schema::Class &cls);
 			const std::string &GetName() const;
 			const std::string &GetDescription() const;
 			const std::vector<WPClassDefinition> &GetBaseClasses() const;
@@ -109,6 +125,8 @@ namespace util
 			const std::vector<KeyValue> &GetInputs() const;
 			const std::vector<KeyValue> &GetOutputs() const;
 			ClassType GetType() const;
+			// Structural hash of the class, including its keyvalues, inputs, outputs and the hashes of its base classes
+			uint64_t GetHash() const;
 
 			// Finds the specified keyvalue located in either this class, or one of this class' base classes
 			const KeyValue *FindKeyValue(const Data &fgdData,const std::string &name) const;
@@ -124,6 +142,7 @@ namespace util
 				Output
 			};
 			const KeyValue *FindKeyValue(const Data &fgdData,KeyValueType type,const std::string &name) const;
+			void UpdateHash();
 
 			std::string m_name = {};
 			std::string m_description = {};
@@ -133,6 +152,39 @@ namespace util
 			std::vector<KeyValue> m_inputs = {};
 			std::vector<KeyValue> m_outputs = {};
 			ClassType m_type = ClassType::Unknown;
+			uint64_t m_hash = 0;
+		};
+
+		// Dense slot table of all keyvalues of a class, including the keyvalues of its base classes.
+		// Slot indices can be resolved once (e.g. when registering an entity class) and then be
+		// used to index a flat array of values, instead of looking up keyvalues by name.
+		// The layout references the keyvalues of the class definitions it was created from, which
+		// have to outlive it.
+		class KeyValueLayout
+		{
+		public:
+			using SlotIndex = uint32_t;
+			static constexpr SlotIndex INVALID_SLOT = std::numeric_limits<SlotIndex>::max();
+			struct Slot
+			{
+				std::string name; // Lower-case
+				KeyValue::Type type;
+				const KeyValue *keyValue;
+			};
+			KeyValueLayout(const ClassDefinition &classDef);
+			const std::vector<Slot> &GetSlots() const;
+			uint32_t GetSlotCount() const;
+			const Slot *GetSlot(SlotIndex slot) const;
+			// Returns INVALID_SLOT if the class has no keyvalue with the specified name (case-insensitive)
+			SlotIndex FindSlot(const std::string &name) const;
+			// Default values of all slots, indexed by slot
+			const std::vector<std::string> &GetDefaultValues() const;
+		private:
+			void AddKeyValues(const ClassDefinition &classDef,std::vector<const ClassDefinition*> &traversed);
+
+			std::vector<Slot> m_slots = {};
+			std::vector<std::string> m_defaultValues = {};
+			std::unordered_map<std::string,SlotIndex> m_nameToSlot = {};
 		};
 
 		struct Data
@@ -140,7 +192,41 @@ namespace util
 			std::pair<int32_t,int32_t> mapSize;
 			std::vector<std::string> includes;
 			std::unordered_map<std::string,PClassDefinition> classDefinitions;
+			// Root hash of all class definitions at load time, see compute_hash. Convenience value (e.g. for cache keys)
+			// that is not updated automatically; It has to be recomputed if classDefinitions is modified.
+			uint64_t hash = 0;
+		};
+
+		// Order-independent combination of the hashes of all class definitions
+		uint64_t compute_hash(const Data &data);
+
+		struct KeyValueDiff
+		{
+			// Lower-case names, sorted
+			std::vector<std::string> added;
+			std::vector<std::string> removed;
+			std::vector<std::string> changed;
+		};
+		struct ClassDiff
+		{
+			std::string name; // Lower-case
+			bool headerChanged = false; // Name, description, type or properties
+			bool baseClassesChanged = false;
+			KeyValueDiff keyValues;
+			KeyValueDiff inputs;
+			KeyValueDiff outputs;
 		};
+		struct DataDiff
+		{
+			// Lower-case class names, sorted
+			std::vector<std::string> addedClasses;
+			std::vector<std::string> removedClasses;
+			std::vector<ClassDiff> changedClasses;
+			bool IsEmpty() const;
+		};
+		// Compares two data sets. Only classes with differing hashes are compared in detail.
+		// Root hashes are always recomputed, Data::hash is ignored.
+		DataDiff diff(const Data &a,const Data &b);
 
 		struct DataObject
 		{
@@ -150,10 +236,81 @@ namespace util
 			std::vector<PDataObject> attributes; // Class fields (description, etc.)
 			std::vector<PDataObject> children; // Class child elements
 		};
-		std::optional<util::fgd::Data> load_fgd(const std::string &fileName,const std::function<std::shared_ptr<VFilePtrInternal>(const std::string&)> &fileFactory,std::unordered_map<std::string,Data> &fgdCache);
-		std::optional<util::fgd::Data> load_fgd(const std::string &fileName,const std::function<std::shared_ptr<VFilePtrInternal>(const std::string&)> &fileFactory);
-		std::optional<util::fgd::Data> load_fgd(const std::string &fileName,std::unordered_map<std::string,Data> &fgdCache);
-		std::optional<util::fgd::Data> load_fgd(const std::string &fileName);
+		// Approximate amount of memory owned by the object, including the object itself
+		size_t get_memory_footprint(const ClassDefinition &classDef);
+		size_t get_memory_footprint(const Data &data);
+
+		// Cache of loaded FGD files with a memory budget. If the budget is exceeded, the least recently
+		// used entries are evicted, unless they're still referenced outside of the cache.
+		// Class definitions shared between entries (e.g. through includes) are only accounted for once.
+		// Data and class definitions that are still referenced outside of the cache (e.g. by a PClassDefinition)
+		// when their entries are removed stay accounted for, until they have been released and the
+		// cache is inserted into or trimmed again.
+		class Cache
+		{
+		public:
+			struct Stats
+			{
+				uint64_t hits = 0;
+				uint64_t misses = 0;
+				uint64_t evictions = 0;
+			};
+			explicit Cache(size_t maxBytes=std::numeric_limits<size_t>::max());
+			// Returns nullptr if no entry exists for the specified (lower-case) file name
+			std::shared_ptr<const Data> Find(const std::string &fileName);
+			std::shared_ptr<const Data> Insert(const std::string &fileName,Data &&data);
+			// Removes all entries; Data and class definitions still referenced elsewhere remain accounted for
+			void Clear();
+			// Evicts unreferenced entries until the memory budget is met
+			void Trim();
+
+			void SetMaxBytes(size_t maxBytes);
+			size_t GetMaxBytes() const;
+			size_t GetUsedBytes() const;
+			size_t GetEntryCount() const;
+			Stats GetStats() const;
+		private:
+			struct Entry
+			{
+				std::shared_ptr<const Data> data;
+				size_t bytes = 0; // Container overhead only, class definitions are tracked in m_classes
+				std::list<std::string>::iterator itLru;
+			};
+			struct ClassEntry
+			{
+				size_t bytes = 0;
+				uint32_t refCount = 0;
+				// Only set while no entry references the class anymore, but it's still alive elsewhere
+				std::weak_ptr<const ClassDefinition> orphan;
+			};
+			struct DataOrphan
+			{
+				std::weak_ptr<const Data> data;
+				size_t bytes = 0;
+			};
+			void Erase(std::unordered_map<std::string,Entry>::iterator it);
+			void TrimUnlocked();
+			void ReleaseOrphans();
+
+			mutable std::mutex m_mutex;
+			size_t m_maxBytes = 0;
+			size_t m_usedBytes = 0;
+			Stats m_stats = {};
+			std::list<std::string> m_lru = {}; // Most recently used first
+			std::unordered_map<std::string,Entry> m_entries = {};
+			std::unordered_map<const ClassDefinition*,ClassEntry> m_classes = {};
+			std::vector<const ClassDefinition*> m_orphans = {};
+			std::vector<DataOrphan> m_dataOrphans = {};
+		};
+
+		// If numThreads is not 1, large files are split at top-level '@' blocks, which are parsed on up to numThreads threads
+		// (0 = hardware concurrency). Base classes are still resolved in declaration order, so the result is the same as with a single thread.
+		std::optional<util::fgd::Data> load_fgd(const std::string &fileName,const std::function<std::shared_ptr<VFilePtrInternal>(const std::string&)> &fileFactory,std::unordered_map<std::string,Data> &fgdCache,uint32_t numThreads=1);
+		std::optional<util::fgd::Data> load_fgd(const std::string &fileName,const std::function<std::shared_ptr<VFilePtrInternal>(const std::string&)> &fileFactory,uint32_t numThreads=1);
+		std::optional<util::fgd::Data> load_fgd(const std::string &fileName,std::unordered_map<std::string,Data> &fgdCache,uint32_t numThreads=1);
+		std::optional<util::fgd::Data> load_fgd(const std::string &fileName,uint32_t numThreads=1);
+		std::shared_ptr<const util::fgd::Data> load_fgd(const std::string &fileName,const std::function<std::shared_ptr<VFilePtrInternal>(const std::string&)> &fileFactory,Cache &cache,uint32_t numThreads=1);
+		std::shared_ptr<const util::fgd::Data> load_fgd(const std::string &fileName,Cache &cache,uint32_t numThreads=1);
 	};
 };
 
@@ -0,0 +1,83 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef __UTIL_FGD_SCHEMA_HPP__
+#define __UTIL_FGD_SCHEMA_HPP__
+
+#include "util_fgd.hpp"
+#include <cinttypes>
+
+// Static representation of a compiled FGD schema. Translation units containing these tables
+// are generated by the util_fgd_compiler tool and can be turned into regular FGD data
+// with util::fgd::schema::load, without having to parse any files at runtime.
+namespace util
+{
+	namespace fgd
+	{
+		namespace schema
+		{
+			struct Choice
+			{
+				const char *key;
+				const char *name;
+				const char *description;
+				bool defaultOn;
+			};
+
+			struct KeyValue
+			{
+				const char *name;
+				const char *shortDescription;
+				const char *longDescription;
+				const char *defaultValue;
+				util::fgd::KeyValue::Type type;
+				const Choice *choices;
+				uint32_t choiceCount;
+			};
+
+			// Class parameter, e.g. base(...), studio(...), size(...)
+			struct Property
+			{
+				const char *name;
+				const char *const *arguments;
+				uint32_t argumentCount;
+			};
+
+			struct Class
+			{
+				const char *name;
+				const char *description;
+				ClassType type;
+				const Property *properties;
+				uint32_t propertyCount;
+				// Indices of the base classes as resolved by the parser. Base classes always
+				// appear before the classes deriving from them.
+				const uint32_t *baseClasses;
+				uint32_t baseClassCount;
+				const KeyValue *keyValues;
+				uint32_t keyValueCount;
+				const KeyValue *inputs;
+				uint32_t inputCount;
+				const KeyValue *outputs;
+				uint32_t outputCount;
+			};
+
+			struct Data
+			{
+				int32_t mapSizeMin;
+				int32_t mapSizeMax;
+				const char *const *includes;
+				uint32_t includeCount;
+				const Class *classes;
+				uint32_t classCount;
+			};
+
+			util::fgd::Data load(const Data &data);
+			// Generates the source code for a translation unit defining 'const util::fgd::schema::Data <symbolName>'
+			std::string generate_source(const util::fgd::Data &data,const std::string &symbolName,const std::string &sourceName="");
+		};
+	};
+};
+
+#endif
@@ -3,10 +3,14 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "util_fgd.hpp"
+#include "util_fgd_schema.hpp"
 #include <iostream>
 #include <stack>
 #include <sstream>
 #include <assert.h>
+#include <thread>
+#include <future>
+#include <algorithm>
 #include <fsys/filesystem.h>
 #include <sharedutils/util.h>
 #include <sharedutils/util_string.h>
@@ -108,6 +112,21 @@ util::fgd::KeyValue::KeyValue(const DataObject &obj)
 			}));
 		}
 	}
+	UpdateHash();
+}
+util::fgd::KeyValue::KeyValue(const schema::KeyValue &kv)
+	: m_name{kv.name},m_shortDesc{kv.shortDescription},m_longDesc{kv.longDescription},
+	m_default{kv.defaultValue},m_type{kv.type}
+{
+	m_choices.reserve(kv.choiceCount);
+	for(auto i=decltype(kv.choiceCount){0u};i<kv.choiceCount;++i)
+	{
+		auto &choice = kv.choices[i];
+		m_choices.insert(std::make_pair(choice.key,Choice{
+			choice.name,choice.description,choice.defaultOn
+		}));
+	}
+	UpdateHash();
 }
 const std::string &util::fgd::KeyValue::GetName() const {return m_name;}
 const std::string &util::fgd::KeyValue::GetShortDescription() const {return m_shortDesc;}
@@ -115,6 +134,7 @@ const std::string &util::fgd::KeyValue::GetLongDescription() const {return m_lon
 const std::string &util::fgd::KeyValue::GetDefault() const {return m_default;}
 util::fgd::KeyValue::Type util::fgd::KeyValue::GetType() const {return m_type;}
 const std::unordered_map<std::string,util::fgd::KeyValue::Choice> &util::fgd::KeyValue::GetChoices() const {return m_choices;}
+uint64_t util::fgd::KeyValue::GetHash() const {return m_hash;}
 
 util::fgd::ClassDefinition::ClassDefinition(const Data &fgdData,const DataObject &obj)
 {
@@ -177,6 +197,40 @@ util::fgd::ClassDefinition::ClassDefinition(const Data &fgdData,const DataObject
 		}
 		m_keyValues.push_back({*child});
 	}
+	UpdateHash();
+}
+util::fgd::ClassDefinition::ClassDefinition(const std::vector<PClassDefinition> &classes,const schema::Class &cls)
+	: m_name{cls.name},m_description{cls.description},m_type{cls.type}
+{
+	m_properties.reserve(cls.propertyCount);
+	for(auto i=decltype(cls.propertyCount){0u};i<cls.propertyCount;++i)
+	{
+		auto &prop = cls.properties[i];
+		auto o = std::make_shared<util::fgd::DataObject>();
+		o->name = prop.name;
+		o->arguments.reserve(prop.argumentCount);
+		for(auto j=decltype(prop.argumentCount){0u};j<prop.argumentCount;++j)
+			o->arguments.push_back(prop.arguments[j]);
+		m_properties.push_back(o);
+	}
+	m_baseClasses.reserve(cls.baseClassCount);
+	for(auto i=decltype(cls.baseClassCount){0u};i<cls.baseClassCount;++i)
+	{
+		auto idx = cls.baseClasses[i];
+		if(idx < classes.size())
+			m_baseClasses.push_back(classes.at(idx));
+	}
+
+	m_keyValues.reserve(cls.keyValueCount);
+	for(auto i=decltype(cls.keyValueCount){0u};i<cls.keyValueCount;++i)
+		m_keyValues.push_back({cls.keyValues[i]});
+	m_inputs.reserve(cls.inputCount);
+	for(auto i=decltype(cls.inputCount){0u};i<cls.inputCount;++i)
+		m_inputs.push_back({cls.inputs[i]});
+	m_outputs.reserve(cls.outputCount);
+	for(auto i=decltype(cls.outputCount){0u};i<cls.outputCount;++i)
+		m_outputs.push_back({cls.outputs[i]});
+	UpdateHash();
 }
 const std::string &util::fgd::ClassDefinition::GetName() const {return m_name;}
 const std::string &util::fgd::ClassDefinition::GetDescription() const {return m_description;}
@@ -186,6 +240,7 @@ const std::vector<util::fgd::KeyValue> &util::fgd::ClassDefinition::GetKeyValues
 const std::vector<util::fgd::KeyValue> &util::fgd::ClassDefinition::GetInputs() const {return m_inputs;}
 const std::vector<util::fgd::KeyValue> &util::fgd::ClassDefinition::GetOutputs() const {return m_outputs;}
 util::fgd::ClassType util::fgd::ClassDefinition::GetType() const {return m_type;}
+uint64_t util::fgd::ClassDefinition::GetHash() const {return m_hash;}
 const util::fgd::KeyValue *util::fgd::ClassDefinition::FindKeyValue(const Data &fgdData,KeyValueType type,const std::string &name) const
 {
 	auto &keyValueList = (type == KeyValueType::KeyValue) ? m_keyValues : (type == KeyValueType::Input) ? m_inputs : m_outputs;
@@ -208,6 +263,49 @@ const util::fgd::KeyValue *util::fgd::ClassDefinition::FindKeyValue(const Data &
 const util::fgd::KeyValue *util::fgd::ClassDefinition::FindInput(const Data &fgdData,const std::string &name) const {return FindKeyValue(fgdData,KeyValueType::Input,name);}
 const util::fgd::KeyValue *util::fgd::ClassDefinition::FindOutput(const Data &fgdData,const std::string &name) const {return FindKeyValue(fgdData,KeyValueType::Output,name);}
 
+util::fgd::KeyValueLayout::KeyValueLayout(const ClassDefinition &classDef)
+{
+	std::vector<const ClassDefinition*> traversed {};
+	AddKeyValues(classDef,traversed);
+}
+void util::fgd::KeyValueLayout::AddKeyValues(const ClassDefinition &classDef,std::vector<const ClassDefinition*> &traversed)
+{
+	if(std::find(traversed.begin(),traversed.end(),&classDef) != traversed.end())
+		return;
+	traversed.push_back(&classDef);
+	// Same lookup order as ClassDefinition::FindKeyValue: The class' own keyvalues take precedence over those of its base classes
+	auto &keyValues = classDef.GetKeyValues();
+	m_slots.reserve(m_slots.size() +keyValues.size());
+	m_defaultValues.reserve(m_defaultValues.size() +keyValues.size());
+	for(auto &keyValue : keyValues)
+	{
+		auto lname = keyValue.GetName();
+		ustring::to_lower(lname);
+		if(m_nameToSlot.find(lname) != m_nameToSlot.end())
+			continue;
+		m_nameToSlot.insert(std::make_pair(lname,static_cast<SlotIndex>(m_slots.size())));
+		m_slots.push_back({lname,keyValue.GetType(),&keyValue});
+		m_defaultValues.push_back(keyValue.GetDefault());
+	}
+	for(auto &wpClass : classDef.GetBaseClasses())
+	{
+		if(wpClass.expired())
+			continue;
+		AddKeyValues(*wpClass.lock(),traversed);
+	}
+}
+const std::vector<util::fgd::KeyValueLayout::Slot> &util::fgd::KeyValueLayout::GetSlots() const {return m_slots;}
+uint32_t util::fgd::KeyValueLayout::GetSlotCount() const {return static_cast<uint32_t>(m_slots.size());}
+const util::fgd::KeyValueLayout::Slot *util::fgd::KeyValueLayout::GetSlot(SlotIndex slot) const {return (slot < m_slots.size()) ? &m_slots.at(slot) : nullptr;}
+util::fgd::KeyValueLayout::SlotIndex util::fgd::KeyValueLayout::FindSlot(const std::string &name) const
+{
+	auto lname = name;
+	ustring::to_lower(lname);
+	auto it = m_nameToSlot.find(lname);
+	return (it != m_nameToSlot.end()) ? it->second : INVALID_SLOT;
+}
+const std::vector<std::string> &util::fgd::KeyValueLayout::GetDefaultValues() const {return m_defaultValues;}
+
 static util::MarkupFile::ResultCode read_arguments(util::MarkupFile &mf,std::vector<std::string> &arguments)
 {
 	std::string str {};
@@ -310,7 +408,15 @@ static util::fgd::PDataObject read_value(util::MarkupFile &mf,util::MarkupFile::
 
 	if(token == '\"')
 	{
-		if((resultCode=mf.ReadNextToken(token)) != util::MarkupFile::ResultCode::Ok)
+		resultCode = mf.ReadNextToken(token);
+		if(resultCode == util::MarkupFile::ResultCode::EndOfFile)
+		{
+			// A quoted value may be the last thing in the input (e.g. '@include "base.fgd"' at the end of a file or of a
+			// parallel parse range). The caller will run into the end of the input again with its next token and stop there.
+			resultCode = util::MarkupFile::ResultCode::Ok;
+			token = '\n';
+		}
+		else if(resultCode != util::MarkupFile::ResultCode::Ok)
 			return nullptr;
 	}
 	auto o = std::make_shared<util::fgd::DataObject>();
@@ -454,20 +560,134 @@ static util::MarkupFile::ResultCode read_block(util::MarkupFile &mf,std::stack<u
 	return util::MarkupFile::ResultCode::Ok;
 }
 
-std::optional<util::fgd::Data> util::fgd::load_fgd(const std::string &fileName,const std::function<std::shared_ptr<VFilePtrInternal>(const std::string&)> &fileFactory,std::unordered_map<std::string,Data> &fgdCache)
+// Returns the offsets of all '@' characters that start a top-level block, ignoring comments, strings and bracketed blocks
+static std::vector<size_t> find_top_level_blocks(const std::string &str)
+{
+	std::vector<size_t> offsets {};
+	auto depth = 0;
+	auto inString = false;
+	for(size_t i=0;i<str.length();++i)
+	{
+		auto c = str.at(i);
+		if(inString)
+		{
+			if(c == '\"')
+				inString = false;
+			continue;
+		}
+		switch(c)
+		{
+			case '\"':
+				inString = true;
+				break;
+			case '/':
+				if(i +1 < str.length() && str.at(i +1) == '/')
+				{
+					i = str.find('\n',i);
+					if(i == std::string::npos)
+						return offsets;
+				}
+				break;
+			case '[':
+				++depth;
+				break;
+			case ']':
+				if(depth > 0)
+					--depth;
+				break;
+			case '@':
+				if(depth == 0)
+					offsets.push_back(i);
+				break;
+		}
+	}
+	return offsets;
+}
+
+static util::MarkupFile::ResultCode read_blocks(const char *data,size_t len,util::fgd::DataObject &root)
+{
+	DataStream ds {const_cast<void*>(reinterpret_cast<const void*>(data)),static_cast<uint32_t>(len)};
+	ds->SetOffset(0u);
+	util::MarkupFile mf{ds};
+	std::stack<util::fgd::PDataObject> objectStack {};
+	objectStack.push(std::shared_ptr<util::fgd::DataObject>{&root,[](util::fgd::DataObject*) {}});
+	return read_block(mf,objectStack);
+}
+
+static void read_blocks(const std::string &str,util::fgd::DataObject &root,uint32_t numThreads)
+{
+	// Splitting small files is not worth the overhead of spawning threads
+	constexpr size_t minBytesPerThread = 64 *1'024;
+	if(numThreads == 0)
+		numThreads = std::max(std::thread::hardware_concurrency(),1u);
+	numThreads = static_cast<uint32_t>(std::min<size_t>(numThreads,str.length() /minBytesPerThread));
+	if(numThreads <= 1)
+	{
+		read_blocks(str.data(),str.length(),root);
+		return;
+	}
+
+	// Split the buffer into contiguous ranges of roughly equal size, at top-level block boundaries
+	auto blockOffsets = find_top_level_blocks(str);
+	std::vector<size_t> rangeOffsets {0};
+	rangeOffsets.reserve(numThreads +1);
+	auto itBlock = blockOffsets.begin();
+	for(auto i=1u;i<numThreads;++i)
+	{
+		auto target = (str.length() *i) /numThreads;
+		itBlock = std::lower_bound(itBlock,blockOffsets.end(),target);
+		if(itBlock == blockOffsets.end())
+			break;
+		if(*itBlock > rangeOffsets.back())
+			rangeOffsets.push_back(*itBlock);
+	}
+	rangeOffsets.push_back(str.length());
+
+	// Each range is parsed into its own root object; Concatenating their children in order yields the same result as a sequential parse
+	auto numRanges = rangeOffsets.size() -1;
+	std::vector<util::fgd::DataObject> rangeRoots(numRanges);
+	std::vector<std::future<util::MarkupFile::ResultCode>> results {};
+	results.reserve(numRanges);
+	for(auto i=decltype(numRanges){0u};i<numRanges;++i)
+	{
+		results.push_back(std::async(std::launch::async,[&str,&rangeOffsets,&rangeRoots,i]() {
+			return read_blocks(str.data() +rangeOffsets.at(i),rangeOffsets.at(i +1) -rangeOffsets.at(i),rangeRoots.at(i));
+		}));
+	}
+	for(auto &result : results)
+		result.wait();
+	// A sequential parse stops at the first range that doesn't end with the end of its input (e.g. a parser error),
+	// so the ranges following it have to be discarded
+	size_t numChildren = 0;
+	auto numValidRanges = numRanges;
+	for(auto i=decltype(numRanges){0u};i<numRanges;++i)
+	{
+		auto r = results.at(i).get(); // Re-throws parser exceptions
+		numChildren += rangeRoots.at(i).children.size();
+		if(r != util::MarkupFile::ResultCode::EndOfFile)
+		{
+			numValidRanges = i +1;
+			break;
+		}
+	}
+	root.children.reserve(root.children.size() +numChildren);
+	for(auto i=decltype(numValidRanges){0u};i<numValidRanges;++i)
+	{
+		auto &rangeRoot = rangeRoots.at(i);
+		root.children.insert(root.children.end(),rangeRoot.children.begin(),rangeRoot.children.end());
+	}
+}
+
+using IncludeLoader = std::function<std::shared_ptr<const util::fgd::Data>(const std::string&)>;
+static std::optional<util::fgd::Data> load_fgd(const std::string &fileName,const std::function<std::shared_ptr<VFilePtrInternal>(const std::string&)> &fileFactory,const IncludeLoader &includeLoader,uint32_t numThreads)
 {
 	auto f = fileFactory(fileName);
 	if(f == nullptr)
 		return {};
 	auto str = f->ReadString();
-	DataStream ds {const_cast<void*>(reinterpret_cast<const void*>(str.data())),static_cast<uint32_t>(str.length())};
-	ds->SetOffset(0u);
-	util::MarkupFile mf{ds};
-	std::stack<util::fgd::PDataObject> objectStack {};
 	auto o = std::make_shared<util::fgd::DataObject>();
-	objectStack.push(o);
-	objectStack.top()->name = "root";
-	read_block(mf,objectStack);
+	o->name = "root";
+	read_blocks(str,*o,numThreads);
 
 	// Convert raw data to FGD data structures
 	util::fgd::Data data {};
@@ -498,10 +718,8 @@ std::optional<util::fgd::Data> util::fgd::load_fgd(const std::string &fileName,c
 
 				auto lIncludeFile = includeFile;
 				ustring::to_lower(lIncludeFile);
-				auto it = fgdCache.find(lIncludeFile);
-
-				auto includeData = (it != fgdCache.end()) ? it->second : util::fgd::load_fgd(lIncludeFile,fileFactory,fgdCache);
-				if(includeData.has_value())
+				auto includeData = includeLoader(lIncludeFile);
+				if(includeData != nullptr)
 				{
 					// Merge data from included file with this file
 					if(data.mapSize.first == 0u && data.mapSize.second == 0u)
@@ -528,29 +746,72 @@ std::optional<util::fgd::Data> util::fgd::load_fgd(const std::string &fileName,c
 		ustring::to_lower(lname);
 		data.classDefinitions.insert(std::make_pair(lname,classDef));
 	}
+	data.hash = util::fgd::compute_hash(data);
+	return data;
+}
+
+std::optional<util::fgd::Data> util::fgd::load_fgd(const std::string &fileName,const std::function<std::shared_ptr<VFilePtrInternal>(const std::string&)> &fileFactory,std::unordered_map<std::string,Data> &fgdCache,uint32_t numThreads)
+{
+	auto data = ::load_fgd(fileName,fileFactory,[&fileFactory,&fgdCache,numThreads](const std::string &lIncludeFile) -> std::shared_ptr<const Data> {
+		auto it = fgdCache.find(lIncludeFile);
+		if(it == fgdCache.end())
+		{
+			if(util::fgd::load_fgd(lIncludeFile,fileFactory,fgdCache,numThreads).has_value() == false)
+				return nullptr;
+			it = fgdCache.find(lIncludeFile);
+			if(it == fgdCache.end())
+				return nullptr;
+		}
+		// Non-owning; References to unordered_map elements stay valid until the element is erased
+		return std::shared_ptr<const Data>{std::shared_ptr<const Data>{},&it->second};
+	},numThreads);
+	if(data.has_value() == false)
+		return {};
 	auto lFileName = fileName;
 	ustring::to_lower(lFileName);
-	fgdCache.insert(std::make_pair(lFileName,data));
+	fgdCache.insert(std::make_pair(lFileName,*data));
 	return data;
 }
 
-std::optional<util::fgd::Data> util::fgd::load_fgd(const std::string &fileName,const std::function<std::shared_ptr<VFilePtrInternal>(const std::string&)> &fileFactory)
+std::shared_ptr<const util::fgd::Data> util::fgd::load_fgd(const std::string &fileName,const std::function<std::shared_ptr<VFilePtrInternal>(const std::string&)> &fileFactory,Cache &cache,uint32_t numThreads)
+{
+	auto lFileName = fileName;
+	ustring::to_lower(lFileName);
+	auto cached = cache.Find(lFileName);
+	if(cached != nullptr)
+		return cached;
+	auto data = ::load_fgd(fileName,fileFactory,[&fileFactory,&cache,numThreads](const std::string &lIncludeFile) {
+		return util::fgd::load_fgd(lIncludeFile,fileFactory,cache,numThreads);
+	},numThreads);
+	if(data.has_value() == false)
+		return nullptr;
+	return cache.Insert(lFileName,std::move(*data));
+}
+
+std::shared_ptr<const util::fgd::Data> util::fgd::load_fgd(const std::string &fileName,Cache &cache,uint32_t numThreads)
+{
+	return load_fgd(fileName,[](const std::string &fileName) {
+		return FileManager::OpenFile(fileName.c_str(),"r");
+	},cache,numThreads);
+}
+
+std::optional<util::fgd::Data> util::fgd::load_fgd(const std::string &fileName,const std::function<std::shared_ptr<VFilePtrInternal>(const std::string&)> &fileFactory,uint32_t numThreads)
 {
 	std::unordered_map<std::string,Data> fgdCache {};
-	return load_fgd(fileName,fileFactory,fgdCache);
+	return load_fgd(fileName,fileFactory,fgdCache,numThreads);
 }
 
-std::optional<util::fgd::Data> util::fgd::load_fgd(const std::string &fileName,std::unordered_map<std::string,Data> &fgdCache)
+std::optional<util::fgd::Data> util::fgd::load_fgd(const std::string &fileName,std::unordered_map<std::string,Data> &fgdCache,uint32_t numThreads)
 {
 	return load_fgd(fileName,[](const std::string &fileName) {
 		return FileManager::OpenFile(fileName.c_str(),"r");
-	},fgdCache);
+	},fgdCache,numThreads);
 }
 
-std::optional<util::fgd::Data> util::fgd::load_fgd(const std::string &fileName)
+std::optional<util::fgd::Data> util::fgd::load_fgd(const std::string &fileName,uint32_t numThreads)
 {
 	std::unordered_map<std::string,Data> fgdCache {};
-	return load_fgd(fileName,fgdCache);
+	return load_fgd(fileName,fgdCache,numThreads);
 }
 
 static void print(const util::fgd::DataObject &o,const std::string &t="")
@@ -0,0 +1,262 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "util_fgd.hpp"
+#include <algorithm>
+
+// Control block of an object allocated with std::make_shared (use and weak count, vtable)
+static constexpr size_t SHARED_CONTROL_BLOCK_SIZE = sizeof(void*) *2;
+
+static size_t get_string_footprint(const std::string &str)
+{
+	// Strings within the small string optimization buffer don't own any heap memory
+	static const auto ssoCapacity = std::string{}.capacity();
+	return (str.capacity() > ssoCapacity) ? (str.capacity() +1) : 0;
+}
+
+template<class T,class TAlloc>
+	static size_t get_vector_footprint(const std::vector<T,TAlloc> &v)
+{
+	return v.capacity() *sizeof(T);
+}
+
+template<class TKey,class TValue>
+	static size_t get_map_footprint(const std::unordered_map<TKey,TValue> &map)
+{
+	// Each node holds a next-pointer, the value and (for non-trivial hashes) the cached hash code
+	return map.bucket_count() *sizeof(void*) +map.size() *(sizeof(void*) +sizeof(typename std::unordered_map<TKey,TValue>::value_type) +sizeof(size_t));
+}
+
+static size_t get_memory_footprint(const util::fgd::DataObject &o)
+{
+	auto bytes = sizeof(o) +SHARED_CONTROL_BLOCK_SIZE +get_string_footprint(o.name);
+	bytes += get_vector_footprint(o.arguments);
+	for(auto &arg : o.arguments)
+		bytes += get_string_footprint(arg);
+	for(auto *objs : {&o.parameters,&o.attributes,&o.children})
+	{
+		bytes += get_vector_footprint(*objs);
+		for(auto &child : *objs)
+			bytes += get_memory_footprint(*child);
+	}
+	return bytes;
+}
+
+// Only includes memory owned by the keyvalue, not the size of the object itself
+static size_t get_memory_footprint(const util::fgd::KeyValue &kv)
+{
+	auto bytes = get_string_footprint(kv.GetName()) +get_string_footprint(kv.GetShortDescription()) +get_string_footprint(kv.GetLongDescription()) +get_string_footprint(kv.GetDefault());
+	auto &choices = kv.GetChoices();
+	bytes += get_map_footprint(choices);
+	for(auto &pair : choices)
+		bytes += get_string_footprint(pair.first) +get_string_footprint(pair.second.name) +get_string_footprint(pair.second.description);
+	return bytes;
+}
+
+// Memory owned by the data, excluding the class definitions themselves
+static size_t get_container_footprint(const util::fgd::Data &data)
+{
+	auto bytes = sizeof(data) +get_vector_footprint(data.includes);
+	for(auto &include : data.includes)
+		bytes += get_string_footprint(include);
+	bytes += get_map_footprint(data.classDefinitions);
+	for(auto &pair : data.classDefinitions)
+		bytes += get_string_footprint(pair.first);
+	return bytes;
+}
+
+size_t util::fgd::get_memory_footprint(const ClassDefinition &classDef)
+{
+	auto bytes = sizeof(classDef) +SHARED_CONTROL_BLOCK_SIZE +get_string_footprint(classDef.GetName()) +get_string_footprint(classDef.GetDescription());
+	bytes += get_vector_footprint(classDef.GetBaseClasses());
+	bytes += get_vector_footprint(classDef.GetProperties());
+	for(auto &prop : classDef.GetProperties())
+		bytes += ::get_memory_footprint(*prop);
+	for(auto *keyValues : {&classDef.GetKeyValues(),&classDef.GetInputs(),&classDef.GetOutputs()})
+	{
+		bytes += get_vector_footprint(*keyValues);
+		for(auto &kv : *keyValues)
+			bytes += ::get_memory_footprint(kv);
+	}
+	return bytes;
+}
+
+size_t util::fgd::get_memory_footprint(const Data &data)
+{
+	auto bytes = get_container_footprint(data);
+	for(auto &pair : data.classDefinitions)
+		bytes += get_memory_footprint(*pair.second);
+	return bytes;
+}
+
+util::fgd::Cache::Cache(size_t maxBytes)
+	: m_maxBytes{maxBytes}
+{}
+
+std::shared_ptr<const util::fgd::Data> util::fgd::Cache::Find(const std::string &fileName)
+{
+	std::scoped_lock lock {m_mutex};
+	auto it = m_entries.find(fileName);
+	if(it == m_entries.end())
+	{
+		++m_stats.misses;
+		return nullptr;
+	}
+	++m_stats.hits;
+	m_lru.splice(m_lru.begin(),m_lru,it->second.itLru);
+	return it->second.data;
+}
+
+std::shared_ptr<const util::fgd::Data> util::fgd::Cache::Insert(const std::string &fileName,Data &&data)
+{
+	std::scoped_lock lock {m_mutex};
+	auto it = m_entries.find(fileName);
+	if(it != m_entries.end())
+		Erase(it);
+	ReleaseOrphans();
+	auto pData = std::make_shared<const Data>(std::move(data));
+	Entry entry {};
+	entry.data = pData;
+	entry.bytes = get_container_footprint(*pData) +SHARED_CONTROL_BLOCK_SIZE;
+	m_usedBytes += entry.bytes;
+	for(auto &pair : pData->classDefinitions)
+	{
+		auto &classEntry = m_classes[pair.second.get()];
+		if(classEntry.refCount++ > 0)
+			continue;
+		if(classEntry.bytes > 0)
+		{
+			// Orphaned class that was kept alive outside of the cache and is still accounted for. If it has been released
+			// in the meantime, this is a different class that was allocated at the same address.
+			m_orphans.erase(std::find(m_orphans.begin(),m_orphans.end(),pair.second.get()));
+			auto isSameClass = (classEntry.orphan.lock() == pair.second);
+			classEntry.orphan.reset();
+			if(isSameClass)
+				continue;
+			m_usedBytes -= classEntry.bytes;
+		}
+		classEntry.bytes = get_memory_footprint(*pair.second);
+		m_usedBytes += classEntry.bytes;
+	}
+	m_lru.push_front(fileName);
+	entry.itLru = m_lru.begin();
+	m_entries.insert(std::make_pair(fileName,std::move(entry)));
+	TrimUnlocked();
+	return pData;
+}
+
+void util::fgd::Cache::Erase(std::unordered_map<std::string,Entry>::iterator it)
+{
+	auto &entry = it->second;
+	// Pinned entries are only erased when they're replaced or the cache is cleared; The data and its classes stay alive
+	// until it's released, so they remain accounted for until then.
+	auto isDataInUse = (entry.data.use_count() > 1);
+	if(isDataInUse)
+		m_dataOrphans.push_back({entry.data,entry.bytes});
+	else
+		m_usedBytes -= entry.bytes;
+	for(auto &pair : entry.data->classDefinitions)
+	{
+		auto itClass = m_classes.find(pair.second.get());
+		if(itClass == m_classes.end() || --itClass->second.refCount > 0)
+			continue;
+		// The entry's own reference is the only one the cache holds. If there are more, the class is still
+		// in use elsewhere and doesn't get freed, so it remains accounted for until it's released.
+		if(isDataInUse || pair.second.use_count() > 1)
+		{
+			itClass->second.orphan = pair.second;
+			m_orphans.push_back(pair.second.get());
+			continue;
+		}
+		m_usedBytes -= itClass->second.bytes;
+		m_classes.erase(itClass);
+	}
+	m_lru.erase(entry.itLru);
+	m_entries.erase(it);
+}
+
+void util::fgd::Cache::ReleaseOrphans()
+{
+	for(auto it=m_dataOrphans.begin();it!=m_dataOrphans.end();)
+	{
+		if(it->data.expired() == false)
+		{
+			++it;
+			continue;
+		}
+		m_usedBytes -= it->bytes;
+		it = m_dataOrphans.erase(it);
+	}
+	for(auto it=m_orphans.begin();it!=m_orphans.end();)
+	{
+		auto itClass = m_classes.find(*it);
+		if(itClass->second.orphan.expired() == false)
+		{
+			++it;
+			continue;
+		}
+		m_usedBytes -= itClass->second.bytes;
+		m_classes.erase(itClass);
+		it = m_orphans.erase(it);
+	}
+}
+
+void util::fgd::Cache::TrimUnlocked()
+{
+	ReleaseOrphans();
+	if(m_usedBytes <= m_maxBytes)
+		return;
+	for(auto itLru = m_lru.end();itLru != m_lru.begin() && m_usedBytes > m_maxBytes;)
+	{
+		--itLru;
+		auto it = m_entries.find(*itLru);
+		// Entries that are still in use elsewhere are pinned; Evicting them wouldn't free any memory
+		if(it->second.data.use_count() > 1)
+			continue;
+		itLru = std::next(itLru);
+		Erase(it);
+		++m_stats.evictions;
+	}
+}
+
+void util::fgd::Cache::Trim()
+{
+	std::scoped_lock lock {m_mutex};
+	TrimUnlocked();
+}
+
+void util::fgd::Cache::Clear()
+{
+	std::scoped_lock lock {m_mutex};
+	while(m_entries.empty() == false)
+		Erase(m_entries.begin());
+	ReleaseOrphans();
+}
+
+void util::fgd::Cache::SetMaxBytes(size_t maxBytes)
+{
+	std::scoped_lock lock {m_mutex};
+	m_maxBytes = maxBytes;
+	TrimUnlocked();
+}
+size_t util::fgd::Cache::GetMaxBytes() const
+{
+	std::scoped_lock lock {m_mutex};
+	return m_maxBytes;
+}
+size_t util::fgd::Cache::GetUsedBytes() const
+{
+	std::scoped_lock lock {m_mutex};
+	return m_usedBytes;
+}
+size_t util::fgd::Cache::GetEntryCount() const
+{
+	std::scoped_lock lock {m_mutex};
+	return m_entries.size();
+}
+util::fgd::Cache::Stats util::fgd::Cache::GetStats() const
+{
+	std::scoped_lock lock {m_mutex};
+	return m_stats;
+}
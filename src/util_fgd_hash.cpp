@@ -0,0 +1,197 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "util_fgd.hpp"
+#include <algorithm>
+#include <sharedutils/util_string.h>
+
+// Hashes have to be stable across runs and platforms (e.g. for asset cache keys), so std::hash can't be used
+static uint64_t hash_mix(uint64_t h)
+{
+	// splitmix64 finalizer
+	h ^= h >>30;
+	h *= 0xbf58476d1ce4e5b9ull;
+	h ^= h >>27;
+	h *= 0x94d049bb133111ebull;
+	h ^= h >>31;
+	return h;
+}
+
+static uint64_t hash_combine(uint64_t seed,uint64_t value)
+{
+	return hash_mix(seed ^(value +0x9e3779b97f4a7c15ull +(seed <<6) +(seed >>2)));
+}
+
+static uint64_t hash_string(const std::string &str)
+{
+	// FNV-1a
+	auto h = 0xcbf29ce484222325ull;
+	for(auto c : str)
+	{
+		h ^= static_cast<uint8_t>(c);
+		h *= 0x100000001b3ull;
+	}
+	return hash_combine(h,str.length());
+}
+
+static uint64_t hash_property(const util::fgd::DataObject &prop)
+{
+	auto h = hash_string(prop.name);
+	h = hash_combine(h,prop.arguments.size());
+	for(auto &arg : prop.arguments)
+		h = hash_combine(h,hash_string(arg));
+	return h;
+}
+
+static uint64_t hash_key_values(uint64_t seed,const std::vector<util::fgd::KeyValue> &keyValues)
+{
+	auto h = hash_combine(seed,keyValues.size());
+	for(auto &kv : keyValues)
+		h = hash_combine(h,kv.GetHash());
+	return h;
+}
+
+void util::fgd::KeyValue::UpdateHash()
+{
+	auto h = hash_string(m_name);
+	h = hash_combine(h,hash_string(m_shortDesc));
+	h = hash_combine(h,hash_string(m_longDesc));
+	h = hash_combine(h,hash_string(m_default));
+	h = hash_combine(h,static_cast<uint64_t>(m_type));
+	// Choices are unordered, so their hashes are combined with a commutative operation
+	uint64_t hChoices = 0;
+	for(auto &pair : m_choices)
+	{
+		auto hChoice = hash_string(pair.first);
+		hChoice = hash_combine(hChoice,hash_string(pair.second.name));
+		hChoice = hash_combine(hChoice,hash_string(pair.second.description));
+		hChoice = hash_combine(hChoice,pair.second.defaultOn ? 1 : 0);
+		hChoices += hash_mix(hChoice);
+	}
+	m_hash = hash_combine(hash_combine(h,m_choices.size()),hChoices);
+}
+
+void util::fgd::ClassDefinition::UpdateHash()
+{
+	auto h = hash_string(m_name);
+	h = hash_combine(h,hash_string(m_description));
+	h = hash_combine(h,static_cast<uint64_t>(m_type));
+	h = hash_combine(h,m_properties.size());
+	for(auto &prop : m_properties)
+		h = hash_combine(h,hash_property(*prop));
+	h = hash_key_values(h,m_keyValues);
+	h = hash_key_values(h,m_inputs);
+	h = hash_key_values(h,m_outputs);
+	// Base classes are always constructed before their derived classes, so their hashes are final at this point
+	h = hash_combine(h,m_baseClasses.size());
+	for(auto &wpBase : m_baseClasses)
+		h = hash_combine(h,wpBase.expired() ? 0 : wpBase.lock()->GetHash());
+	m_hash = h;
+}
+
+uint64_t util::fgd::compute_hash(const Data &data)
+{
+	uint64_t h = 0;
+	for(auto &pair : data.classDefinitions)
+		h += hash_mix(hash_combine(hash_string(pair.first),pair.second->GetHash()));
+	return hash_combine(h,data.classDefinitions.size());
+}
+
+bool util::fgd::DataDiff::IsEmpty() const {return addedClasses.empty() && removedClasses.empty() && changedClasses.empty();}
+
+static util::fgd::KeyValueDiff diff_key_values(const std::vector<util::fgd::KeyValue> &a,const std::vector<util::fgd::KeyValue> &b)
+{
+	util::fgd::KeyValueDiff diff {};
+	std::unordered_map<std::string,const util::fgd::KeyValue*> keyValuesA {};
+	keyValuesA.reserve(a.size());
+	for(auto &kv : a)
+	{
+		auto lname = kv.GetName();
+		ustring::to_lower(lname);
+		keyValuesA.insert(std::make_pair(lname,&kv));
+	}
+	for(auto &kv : b)
+	{
+		auto lname = kv.GetName();
+		ustring::to_lower(lname);
+		auto it = keyValuesA.find(lname);
+		if(it == keyValuesA.end())
+		{
+			diff.added.push_back(lname);
+			continue;
+		}
+		if(it->second->GetHash() != kv.GetHash())
+			diff.changed.push_back(lname);
+		keyValuesA.erase(it);
+	}
+	for(auto &pair : keyValuesA)
+		diff.removed.push_back(pair.first);
+	std::sort(diff.added.begin(),diff.added.end());
+	std::sort(diff.removed.begin(),diff.removed.end());
+	std::sort(diff.changed.begin(),diff.changed.end());
+	return diff;
+}
+
+static bool is_header_equal(const util::fgd::ClassDefinition &a,const util::fgd::ClassDefinition &b)
+{
+	if(a.GetName() != b.GetName() || a.GetDescription() != b.GetDescription() || a.GetType() != b.GetType())
+		return false;
+	auto &propsA = a.GetProperties();
+	auto &propsB = b.GetProperties();
+	return std::equal(propsA.begin(),propsA.end(),propsB.begin(),propsB.end(),[](const util::fgd::PDataObject &propA,const util::fgd::PDataObject &propB) {
+		return propA->name == propB->name && propA->arguments == propB->arguments;
+	});
+}
+
+static bool are_base_classes_equal(const util::fgd::ClassDefinition &a,const util::fgd::ClassDefinition &b)
+{
+	auto &basesA = a.GetBaseClasses();
+	auto &basesB = b.GetBaseClasses();
+	return std::equal(basesA.begin(),basesA.end(),basesB.begin(),basesB.end(),[](const util::fgd::WPClassDefinition &baseA,const util::fgd::WPClassDefinition &baseB) {
+		if(baseA.expired() || baseB.expired())
+			return baseA.expired() == baseB.expired();
+		return baseA.lock()->GetHash() == baseB.lock()->GetHash();
+	});
+}
+
+util::fgd::DataDiff util::fgd::diff(const Data &a,const Data &b)
+{
+	DataDiff diff {};
+	// Data::hash is not used, since it goes stale if classes are added, removed or replaced after loading.
+	// The class hashes are cached, so this is only a single pass over the classes.
+	if(compute_hash(a) == compute_hash(b))
+		return diff;
+	for(auto &pairA : a.classDefinitions)
+	{
+		auto itB = b.classDefinitions.find(pairA.first);
+		if(itB == b.classDefinitions.end())
+		{
+			diff.removedClasses.push_back(pairA.first);
+			continue;
+		}
+		auto &classA = *pairA.second;
+		auto &classB = *itB->second;
+		if(classA.GetHash() == classB.GetHash())
+			continue;
+		ClassDiff classDiff {};
+		classDiff.name = pairA.first;
+		classDiff.headerChanged = (is_header_equal(classA,classB) == false);
+		classDiff.baseClassesChanged = (are_base_classes_equal(classA,classB) == false);
+		classDiff.keyValues = diff_key_values(classA.GetKeyValues(),classB.GetKeyValues());
+		classDiff.inputs = diff_key_values(classA.GetInputs(),classB.GetInputs());
+		classDiff.outputs = diff_key_values(classA.GetOutputs(),classB.GetOutputs());
+		diff.changedClasses.push_back(std::move(classDiff));
+	}
+	for(auto &pairB : b.classDefinitions)
+	{
+		if(a.classDefinitions.find(pairB.first) == a.classDefinitions.end())
+			diff.addedClasses.push_back(pairB.first);
+	}
+	std::sort(diff.addedClasses.begin(),diff.addedClasses.end());
+	std::sort(diff.removedClasses.begin(),diff.removedClasses.end());
+	std::sort(diff.changedClasses.begin(),diff.changedClasses.end(),[](const ClassDiff &a,const ClassDiff &b) {
+		return a.name < b.name;
+	});
+	return diff;
+}
@@ -0,0 +1,342 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "util_fgd_schema.hpp"
+#include <sstream>
+#include <algorithm>
+#include <unordered_set>
+#include <sharedutils/util_string.h>
+
+util::fgd::Data util::fgd::schema::load(const Data &data)
+{
+	util::fgd::Data fgdData {};
+	fgdData.mapSize = {data.mapSizeMin,data.mapSizeMax};
+	fgdData.includes.reserve(data.includeCount);
+	for(auto i=decltype(data.includeCount){0u};i<data.includeCount;++i)
+		fgdData.includes.push_back(data.includes[i]);
+	fgdData.classDefinitions.reserve(data.classCount);
+	std::vector<util::fgd::PClassDefinition> classes {};
+	classes.reserve(data.classCount);
+	for(auto i=decltype(data.classCount){0u};i<data.classCount;++i)
+	{
+		auto classDef = std::make_shared<util::fgd::ClassDefinition>(classes,data.classes[i]);
+		classes.push_back(classDef);
+		auto lname = classDef->GetName();
+		ustring::to_lower(lname);
+		fgdData.classDefinitions.insert(std::make_pair(lname,classDef));
+	}
+	fgdData.hash = compute_hash(fgdData);
+	return fgdData;
+}
+
+static const char *class_type_to_string(util::fgd::ClassType type)
+{
+	switch(type)
+	{
+		case util::fgd::ClassType::Base:
+			return "Base";
+		case util::fgd::ClassType::Point:
+			return "Point";
+		case util::fgd::ClassType::NPC:
+			return "NPC";
+		case util::fgd::ClassType::Solid:
+			return "Solid";
+		case util::fgd::ClassType::KeyFrame:
+			return "KeyFrame";
+		case util::fgd::ClassType::Move:
+			return "Move";
+		case util::fgd::ClassType::Filter:
+			return "Filter";
+		case util::fgd::ClassType::Unknown:
+			break;
+	}
+	return "Unknown";
+}
+
+static const char *key_value_type_to_string(util::fgd::KeyValue::Type type)
+{
+	using Type = util::fgd::KeyValue::Type;
+	switch(type)
+	{
+		case Type::Void:
+			return "Void";
+		case Type::String:
+			return "String";
+		case Type::Integer:
+			return "Integer";
+		case Type::Float:
+			return "Float";
+		case Type::Choices:
+			return "Choices";
+		case Type::Flags:
+			return "Flags";
+		case Type::Axis:
+			return "Axis";
+		case Type::Angle:
+			return "Angle";
+		case Type::Color255:
+			return "Color255";
+		case Type::Color1:
+			return "Color1";
+		case Type::FilterClass:
+			return "FilterClass";
+		case Type::Material:
+			return "Material";
+		case Type::NodeDest:
+			return "NodeDest";
+		case Type::NPCClass:
+			return "NPCClass";
+		case Type::Origin:
+			return "Origin";
+		case Type::PointEntityClass:
+			return "PointEntityClass";
+		case Type::Scene:
+			return "Scene";
+		case Type::SideList:
+			return "SideList";
+		case Type::Sound:
+			return "Sound";
+		case Type::Sprite:
+			return "Sprite";
+		case Type::Studio:
+			return "Studio";
+		case Type::TargetDestination:
+			return "TargetDestination";
+		case Type::TargetNameOrClass:
+			return "TargetNameOrClass";
+		case Type::TargetSource:
+			return "TargetSource";
+		case Type::VecLine:
+			return "VecLine";
+		case Type::Vector:
+			return "Vector";
+		case Type::Unknown:
+			break;
+	}
+	return "Unknown";
+}
+
+static std::string to_string_literal(const std::string &str)
+{
+	std::string r {};
+	r.reserve(str.length() +2);
+	r += '\"';
+	for(auto c : str)
+	{
+		switch(c)
+		{
+			case '\"':
+				r += "\\\"";
+				break;
+			case '\\':
+				r += "\\\\";
+				break;
+			case '\n':
+				r += "\\n";
+				break;
+			case '\r':
+				r += "\\r";
+				break;
+			case '\t':
+				r += "\\t";
+				break;
+			default:
+			{
+				auto uc = static_cast<unsigned char>(c);
+				if(uc < 0x20 || uc >= 0x7F)
+				{
+					// Octal escape sequences are limited to three digits, so they can't swallow subsequent characters
+					char buf[5];
+					buf[0] = '\\';
+					buf[1] = static_cast<char>('0' +((uc >>6) &7));
+					buf[2] = static_cast<char>('0' +((uc >>3) &7));
+					buf[3] = static_cast<char>('0' +(uc &7));
+					buf[4] = '\0';
+					r += buf;
+				}
+				else
+					r += c;
+				break;
+			}
+		}
+	}
+	r += '\"';
+	return r;
+}
+
+static void write_key_values(std::stringstream &ss,const std::string &identifier,const std::vector<util::fgd::KeyValue> &keyValues)
+{
+	if(keyValues.empty())
+		return;
+	for(auto i=decltype(keyValues.size()){0u};i<keyValues.size();++i)
+	{
+		auto &choices = keyValues.at(i).GetChoices();
+		if(choices.empty())
+			continue;
+		// Sort choices to keep the output deterministic
+		std::vector<const std::pair<const std::string,util::fgd::KeyValue::Choice>*> sortedChoices {};
+		sortedChoices.reserve(choices.size());
+		for(auto &pair : choices)
+			sortedChoices.push_back(&pair);
+		std::sort(sortedChoices.begin(),sortedChoices.end(),[](const auto *a,const auto *b) {
+			return a->first < b->first;
+		});
+		ss<<"\tconstexpr util::fgd::schema::Choice "<<identifier<<i<<"Choices[] = {\n";
+		for(auto *pair : sortedChoices)
+		{
+			ss<<"\t\t{"<<to_string_literal(pair->first)<<","<<to_string_literal(pair->second.name)<<","
+				<<to_string_literal(pair->second.description)<<","<<(pair->second.defaultOn ? "true" : "false")<<"},\n";
+		}
+		ss<<"\t};\n";
+	}
+	ss<<"\tconstexpr util::fgd::schema::KeyValue "<<identifier<<"s[] = {\n";
+	for(auto i=decltype(keyValues.size()){0u};i<keyValues.size();++i)
+	{
+		auto &kv = keyValues.at(i);
+		ss<<"\t\t{"<<to_string_literal(kv.GetName())<<","<<to_string_literal(kv.GetShortDescription())<<","
+			<<to_string_literal(kv.GetLongDescription())<<","<<to_string_literal(kv.GetDefault())<<","
+			<<"util::fgd::KeyValue::Type::"<<key_value_type_to_string(kv.GetType())<<",";
+		if(kv.GetChoices().empty())
+			ss<<"nullptr,0";
+		else
+			ss<<identifier<<i<<"Choices,"<<kv.GetChoices().size();
+		ss<<"},\n";
+	}
+	ss<<"\t};\n";
+}
+
+static void write_array_ref(std::stringstream &ss,const std::string &identifier,size_t count)
+{
+	if(count == 0)
+		ss<<"nullptr,0";
+	else
+		ss<<identifier<<","<<count;
+}
+
+std::string util::fgd::schema::generate_source(const util::fgd::Data &data,const std::string &symbolName,const std::string &sourceName)
+{
+	// Base classes have to be defined before the classes deriving from them
+	std::vector<const util::fgd::ClassDefinition*> classes {};
+	classes.reserve(data.classDefinitions.size());
+	std::unordered_set<const util::fgd::ClassDefinition*> visited {};
+	std::function<void(const util::fgd::ClassDefinition&)> fAddClass = nullptr;
+	fAddClass = [&classes,&visited,&fAddClass](const util::fgd::ClassDefinition &classDef) {
+		if(visited.find(&classDef) != visited.end())
+			return;
+		visited.insert(&classDef);
+		for(auto &wpBase : classDef.GetBaseClasses())
+		{
+			if(wpBase.expired() == false)
+				fAddClass(*wpBase.lock());
+		}
+		classes.push_back(&classDef);
+	};
+	std::vector<const std::pair<const std::string,util::fgd::PClassDefinition>*> sortedClasses {};
+	sortedClasses.reserve(data.classDefinitions.size());
+	for(auto &pair : data.classDefinitions)
+		sortedClasses.push_back(&pair);
+	std::sort(sortedClasses.begin(),sortedClasses.end(),[](const auto *a,const auto *b) {
+		return a->first < b->first;
+	});
+	for(auto *pair : sortedClasses)
+		fAddClass(*pair->second);
+	std::unordered_map<const util::fgd::ClassDefinition*,size_t> classIndices {};
+	classIndices.reserve(classes.size());
+	for(auto i=decltype(classes.size()){0u};i<classes.size();++i)
+		classIndices.insert(std::make_pair(classes.at(i),i));
+
+	std::stringstream ss {};
+	ss<<"// This file was generated by util_fgd_compiler";
+	if(sourceName.empty() == false)
+		ss<<" from \""<<sourceName<<"\"";
+	ss<<". Do not edit.\n";
+	ss<<"#include <util_fgd_schema.hpp>\n\n";
+	ss<<"namespace\n{\n";
+	for(auto i=decltype(classes.size()){0u};i<classes.size();++i)
+	{
+		auto &classDef = *classes.at(i);
+		auto prefix = "class" +std::to_string(i);
+		auto &props = classDef.GetProperties();
+		// Only emit the base classes the parser actually resolved, so the schema links exactly the same classes
+		std::vector<size_t> baseClassIndices {};
+		for(auto &wpBase : classDef.GetBaseClasses())
+		{
+			if(wpBase.expired())
+				continue;
+			baseClassIndices.push_back(classIndices.at(wpBase.lock().get()));
+		}
+		if(baseClassIndices.empty() == false)
+		{
+			ss<<"\tconstexpr uint32_t "<<prefix<<"BaseClasses[] = {";
+			for(auto idx : baseClassIndices)
+				ss<<idx<<",";
+			ss<<"};\n";
+		}
+		for(auto j=decltype(props.size()){0u};j<props.size();++j)
+		{
+			auto &args = props.at(j)->arguments;
+			if(args.empty())
+				continue;
+			ss<<"\tconstexpr const char *"<<prefix<<"Property"<<j<<"Arguments[] = {";
+			for(auto &arg : args)
+				ss<<to_string_literal(arg)<<",";
+			ss<<"};\n";
+		}
+		if(props.empty() == false)
+		{
+			ss<<"\tconstexpr util::fgd::schema::Property "<<prefix<<"Properties[] = {\n";
+			for(auto j=decltype(props.size()){0u};j<props.size();++j)
+			{
+				ss<<"\t\t{"<<to_string_literal(props.at(j)->name)<<",";
+				write_array_ref(ss,prefix +"Property" +std::to_string(j) +"Arguments",props.at(j)->arguments.size());
+				ss<<"},\n";
+			}
+			ss<<"\t};\n";
+		}
+		write_key_values(ss,prefix +"KeyValue",classDef.GetKeyValues());
+		write_key_values(ss,prefix +"Input",classDef.GetInputs());
+		write_key_values(ss,prefix +"Output",classDef.GetOutputs());
+	}
+	if(data.includes.empty() == false)
+	{
+		ss<<"\tconstexpr const char *includes[] = {";
+		for(auto &include : data.includes)
+			ss<<to_string_literal(include)<<",";
+		ss<<"};\n";
+	}
+	if(classes.empty() == false)
+	{
+		ss<<"\tconstexpr util::fgd::schema::Class classes[] = {\n";
+		for(auto i=decltype(classes.size()){0u};i<classes.size();++i)
+		{
+			auto &classDef = *classes.at(i);
+			auto prefix = "class" +std::to_string(i);
+			ss<<"\t\t{"<<to_string_literal(classDef.GetName())<<","<<to_string_literal(classDef.GetDescription())<<","
+				<<"util::fgd::ClassType::"<<class_type_to_string(classDef.GetType())<<",";
+			write_array_ref(ss,prefix +"Properties",classDef.GetProperties().size());
+			ss<<",";
+			auto numBaseClasses = std::count_if(classDef.GetBaseClasses().begin(),classDef.GetBaseClasses().end(),[](const util::fgd::WPClassDefinition &wpBase) {
+				return wpBase.expired() == false;
+			});
+			write_array_ref(ss,prefix +"BaseClasses",numBaseClasses);
+			ss<<",";
+			write_array_ref(ss,prefix +"KeyValues",classDef.GetKeyValues().size());
+			ss<<",";
+			write_array_ref(ss,prefix +"Inputs",classDef.GetInputs().size());
+			ss<<",";
+			write_array_ref(ss,prefix +"Outputs",classDef.GetOutputs().size());
+			ss<<"},\n";
+		}
+		ss<<"\t};\n";
+	}
+	ss<<"};\n\n";
+	ss<<"extern const util::fgd::schema::Data "<<symbolName<<";\n";
+	ss<<"const util::fgd::schema::Data "<<symbolName<<" {\n";
+	ss<<"\t"<<data.mapSize.first<<","<<data.mapSize.second<<",\n\t";
+	write_array_ref(ss,"includes",data.includes.size());
+	ss<<",\n\t";
+	write_array_ref(ss,"classes",classes.size());
+	ss<<"\n};\n";
+	return ss.str();
+}